@@ -2,8 +2,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <boost/tokenizer.hpp>
+#include <exception>
 #include <iostream>
+#include <memory>
 
+#include "market_data.hpp"
 #include "order_book.hpp"
 
 using namespace boost;
@@ -99,8 +102,8 @@ string commandLine(OrderBook &ob, vector<string> &tokens) {
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(stdout, "Usage: %s tick_size precision\n", argv[0]);
+    if (argc != 3 && argc != 4) {
+        fprintf(stdout, "Usage: %s tick_size precision [shm_name]\n", argv[0]);
         return 1;
     }
 
@@ -108,6 +111,17 @@ int main(int argc, char *argv[]) {
     double precision = stod(argv[2]);
     OrderBook ob(tickSize, precision);
 
+    // Optional market data feed, published once per command
+    unique_ptr<MarketDataPublisher> publisher;
+    if (argc == 4) {
+        try {
+            publisher = make_unique<MarketDataPublisher>(ob, argv[3], 4096);
+        } catch (const std::exception &e) {
+            cerr << "Cannot publish market data: " << e.what() << endl;
+            return 1;
+        }
+    }
+
     cout << ">> ";
     char_separator<char> sep(" ");
     for (string line; getline(cin, line);) {
@@ -119,6 +133,9 @@ int main(int argc, char *argv[]) {
                 v.push_back(*it);
             }
             output = commandLine(ob, v);
+            if (publisher) {
+                publisher->publish();
+            }
         }
         cout << output << endl
              << ">> ";
@@ -0,0 +1,164 @@
+#include "market_data.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+MarketDataPublisher::MarketDataPublisher(OrderBook &ob_, const string &name_, uint64_t capacity)
+    : ob(ob_), name(name_), size(sizeof(DeltaRingHeader) + capacity * sizeof(DeltaRecord)) {
+    if (capacity == 0) {
+        throw invalid_argument("Ring capacity must be positive");
+    }
+
+    // Replace any segment left by a previous publisher, so that the ring always
+    // starts zero filled. Subscribers still mapping the old one stop receiving.
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        throw system_error(errno, generic_category(), "shm_open " + name);
+    }
+    if (ftruncate(fd, size) < 0) {
+        int err = errno;
+        close(fd);
+        shm_unlink(name.c_str());
+        throw system_error(err, generic_category(), "ftruncate " + name);
+    }
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (p == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw system_error(err, generic_category(), "mmap " + name);
+    }
+
+    // The segment was just created zero filled, which leaves every slot empty
+    header = static_cast<DeltaRingHeader *>(p);
+    ring = reinterpret_cast<DeltaRecord *>(header + 1);
+    header->version = DELTA_RING_VERSION;
+    header->capacity = capacity;
+    header->sequence.store(0, memory_order_relaxed);
+    // Written last, a subscriber seeing the magic sees an initialized header
+    atomic_thread_fence(memory_order_release);
+    header->magic = DELTA_RING_MAGIC;
+
+    ob.trackChanges(true);
+}
+
+MarketDataPublisher::~MarketDataPublisher() {
+    ob.trackChanges(false);
+    munmap(header, size);
+    shm_unlink(name.c_str());
+}
+
+// Emit the levels changed since the last publish as one batch, returns the
+// number of deltas. Subscribers only see the batch once all of it is written.
+int MarketDataPublisher::publish() {
+    vector<LevelDelta> deltas = ob.flushChanges();
+    uint64_t seq = header->sequence.load(memory_order_relaxed);
+    for (size_t i = 0; i < deltas.size(); i++) {
+        seq++;
+        DeltaRecord &record = ring[(seq - 1) % header->capacity];
+
+        // Mark the slot as busy so that readers discard a partially written record
+        record.sequence.store(0, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        record.bid = deltas[i].bid;
+        record.lastInBatch = i + 1 == deltas.size();
+        record.price = deltas[i].price;
+        record.quantity = deltas[i].quantity;
+        record.nItems = deltas[i].nItems;
+        record.sequence.store(seq, memory_order_release);
+    }
+    header->sequence.store(seq, memory_order_release);
+    return deltas.size();
+}
+
+MarketDataSubscriber::MarketDataSubscriber(const string &name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw system_error(errno, generic_category(), "shm_open " + name);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int err = errno;
+        close(fd);
+        throw system_error(err, generic_category(), "fstat " + name);
+    }
+    size = st.st_size;
+    if (size < sizeof(DeltaRingHeader)) {
+        close(fd);
+        throw runtime_error("Segment too small for a delta ring: " + name);
+    }
+    void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (p == MAP_FAILED) {
+        throw system_error(err, generic_category(), "mmap " + name);
+    }
+
+    header = static_cast<DeltaRingHeader *>(p);
+    ring = reinterpret_cast<DeltaRecord *>(header + 1);
+    uint32_t magic = header->magic;
+    atomic_thread_fence(memory_order_acquire);
+    capacity = header->capacity;
+    if (magic != DELTA_RING_MAGIC || header->version != DELTA_RING_VERSION) {
+        munmap(p, size);
+        throw runtime_error("Not a compatible delta ring: " + name);
+    }
+    if (capacity == 0 || (size - sizeof(DeltaRingHeader)) / sizeof(DeltaRecord) < capacity) {
+        munmap(p, size);
+        throw runtime_error("Segment too small for its ring capacity: " + name);
+    }
+    // Only deltas published after subscribing are read
+    next = header->sequence.load(memory_order_acquire) + 1;
+}
+
+MarketDataSubscriber::~MarketDataSubscriber() {
+    munmap(header, size);
+}
+
+// Read the next delta, returns false if none was published yet or if the next
+// slot is being written. Overrun is set when the publisher lapped the
+// subscriber and deltas were lost, the subscriber should then resync its view
+// of the book, for instance from queryDepth. LastInBatch is set on the last
+// delta of a publish, when the levels read so far form a consistent book.
+bool MarketDataSubscriber::poll(LevelDelta &delta, bool &overrun, bool &lastInBatch) {
+    overrun = false;
+    // A slot overwritten while being read is retried a bounded number of times
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint64_t last = header->sequence.load(memory_order_acquire);
+        if (last < next) {
+            return false;
+        }
+        if (capacity < last - next + 1) {
+            // Resume at the oldest slot still valid
+            next = last - capacity + 1;
+            overrun = true;
+        }
+
+        const DeltaRecord &record = ring[(next - 1) % capacity];
+        uint64_t seq = record.sequence.load(memory_order_acquire);
+        if (seq == 0) {
+            return false;
+        }
+        if (seq != next) {
+            continue;
+        }
+        delta.bid = record.bid;
+        lastInBatch = record.lastInBatch;
+        delta.price = record.price;
+        delta.quantity = record.quantity;
+        delta.nItems = record.nItems;
+        atomic_thread_fence(memory_order_acquire);
+        if (record.sequence.load(memory_order_relaxed) != next) {
+            continue;
+        }
+        next++;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,76 @@
+#ifndef MARKETDATA_H
+#define MARKETDATA_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "order_book.hpp"
+
+using namespace std;
+
+// One slot of the ring. The sequence is zero while the slot is being written,
+// and set to the delta's sequence number (starting at 1) once it is complete.
+// The last delta of each publish is flagged, so that readers can apply a
+// batch as a whole and never show a book halfway through a command.
+struct DeltaRecord {
+    atomic<uint64_t> sequence;
+    uint8_t bid;
+    uint8_t lastInBatch;
+    double price;
+    int64_t quantity;
+    int32_t nItems;
+};
+
+const uint32_t DELTA_RING_MAGIC = 0x4f424452;  // "OBDR"
+const uint32_t DELTA_RING_VERSION = 1;
+
+// Shared memory layout: this header followed by `capacity` records. The
+// sequence is the last delta of the last complete batch.
+struct DeltaRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    atomic<uint64_t> sequence;
+};
+
+// Writes conflated level deltas of an order book into a POSIX shared memory
+// ring, to be read by local subscriber processes. The order book only tracks
+// changed levels while a publisher is attached to it.
+class MarketDataPublisher {
+   private:
+    OrderBook &ob;
+    string name;
+    size_t size;
+    DeltaRingHeader *header;
+    DeltaRecord *ring;
+
+   public:
+    MarketDataPublisher(OrderBook &ob, const string &name, uint64_t capacity);
+    ~MarketDataPublisher();
+    MarketDataPublisher(const MarketDataPublisher &) = delete;
+    MarketDataPublisher &operator=(const MarketDataPublisher &) = delete;
+    int publish();
+};
+
+// Reads deltas from a ring created by a MarketDataPublisher. A subscriber
+// falling more than a full ring behind skips to the oldest delta available,
+// and poll reports the overrun. A segment that is not a compatible ring, or is
+// too small for its capacity, is rejected.
+class MarketDataSubscriber {
+   private:
+    size_t size;
+    DeltaRingHeader *header;
+    DeltaRecord *ring;
+    uint64_t capacity;
+    uint64_t next;
+
+   public:
+    MarketDataSubscriber(const string &name);
+    ~MarketDataSubscriber();
+    MarketDataSubscriber(const MarketDataSubscriber &) = delete;
+    MarketDataSubscriber &operator=(const MarketDataSubscriber &) = delete;
+    bool poll(LevelDelta &delta, bool &overrun, bool &lastInBatch);
+};
+
+#endif /* MARKETDATA_H */
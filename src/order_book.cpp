@@ -28,7 +28,7 @@ bool PriceLevel::cancel(long long orderID, shared_mutex &m) {
             if (s.size() == 0) {
                 this->quantity = 0;
             } else {
-                this->quantity -= it->quantity;
+                this->quantity -= it->left;
             }
             s.erase(it);
             return true;
@@ -71,7 +71,7 @@ void PriceLevel::update(LimitOrder &&order, shared_mutex &m) {
 }
 
 OrderBook::OrderBook(double tickSize_, double precision_)
-    : tickSize(tickSize_), precision(precision_) {
+    : tracking(false), tickSize(tickSize_), precision(precision_), fills(0) {
 }
 
 bool OrderBook::add(LimitOrder &&order) {
@@ -110,6 +110,7 @@ bool OrderBook::add(LimitOrder &&order) {
             std::unique_lock lock(sellMutex);
             sellOrders[order.price].insert(order);
         }
+        markChanged(order.isBuyOrder, order.price);
     }
 
     return true;
@@ -136,6 +137,7 @@ bool OrderBook::amend(long long orderID, long quantity) {
     it->second.left += delta;
 
     LimitOrder order = it->second;
+    markChanged(order.isBuyOrder, order.price);
     if (order.isBuyOrder) {
         buyOrders[order.price].update(move(order), buyMutex);
     } else {
@@ -172,15 +174,56 @@ bool OrderBook::cancel(long long orderID) {
             sellOrders.erase(price);
         }
     }
+    if (success) {
+        markChanged(isBuyOrder, price);
+    }
     return success;
 }
 
+// FNV-1a hash of the resting orders of both sides, in priority order, so that
+// two books holding the same orders at the same positions share a digest.
+// Each side is prefixed with a tag and its level count to tell bids from asks.
+uint64_t OrderBook::digest() {
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void *data, size_t n) {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < n; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    auto mixSide = [&mix](char side, const map<double, PriceLevel> &m) {
+        size_t nLevels = m.size();
+        mix(&side, sizeof(side));
+        mix(&nLevels, sizeof(nLevels));
+        for (auto &level : m) {
+            mix(&level.first, sizeof(level.first));
+            mix(&level.second.quantity, sizeof(level.second.quantity));
+            for (auto &lo : level.second.orders) {
+                mix(&lo.id, sizeof(lo.id));
+                mix(&lo.left, sizeof(lo.left));
+            }
+        }
+    };
+
+    {
+        std::shared_lock lock(buyMutex);
+        mixSide('b', buyOrders);
+    }
+    {
+        std::shared_lock lock(sellMutex);
+        mixSide('s', sellOrders);
+    }
+    return hash;
+}
+
 // Fill at much as possible at a given price level
 void OrderBook::fill(PriceLevel &pl, LimitOrder &order) {
     set<LimitOrder>::iterator it;
     std::unique_lock lock(ordersMutex);
 
-    for (it = pl.orders.begin(); it != pl.orders.end(); it++) {
+    for (it = pl.orders.begin(); it != pl.orders.end();) {
+        fills++;
         if (order.left <= it->left) {
             pl.quantity -= order.left;
             it->left -= order.left;
@@ -195,7 +238,8 @@ void OrderBook::fill(PriceLevel &pl, LimitOrder &order) {
             order.left = 0;
             return;
         } else {
-            LimitOrder oo = pl.orders.extract(it).value();
+            // Advance before extracting, extract invalidates the iterator
+            LimitOrder oo = pl.orders.extract(it++).value();
             pl.quantity -= oo.left;
             order.left -= oo.left;
             orders.at(oo.id).status = OrderStatus::executed;
@@ -204,6 +248,56 @@ void OrderBook::fill(PriceLevel &pl, LimitOrder &order) {
     }
 }
 
+// Return one delta per price level changed since the previous call, with the
+// level's current aggregate quantity and order count (zero if it was removed)
+vector<LevelDelta> OrderBook::flushChanges() {
+    set<double> bids;
+    set<double> asks;
+    {
+        std::lock_guard lock(changesMutex);
+        bids.swap(changedBids);
+        asks.swap(changedAsks);
+    }
+
+    vector<LevelDelta> deltas;
+    deltas.reserve(bids.size() + asks.size());
+    {
+        std::shared_lock lock(buyMutex);
+        for (double price : bids) {
+            auto it = buyOrders.find(price);
+            if (it == buyOrders.end()) {
+                deltas.push_back({true, price, 0, 0});
+            } else {
+                deltas.push_back({true, price, it->second.quantity, it->second.nItems()});
+            }
+        }
+    }
+    {
+        std::shared_lock lock(sellMutex);
+        for (double price : asks) {
+            auto it = sellOrders.find(price);
+            if (it == sellOrders.end()) {
+                deltas.push_back({false, price, 0, 0});
+            } else {
+                deltas.push_back({false, price, it->second.quantity, it->second.nItems()});
+            }
+        }
+    }
+    return deltas;
+}
+
+void OrderBook::markChanged(bool bid, double price) {
+    if (!tracking.load(memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard lock(changesMutex);
+    if (bid) {
+        changedBids.insert(price);
+    } else {
+        changedAsks.insert(price);
+    }
+}
+
 void OrderBook::match(LimitOrder &order) {
     if (order.isBuyOrder) {
         std::unique_lock lock(sellMutex);
@@ -214,6 +308,7 @@ void OrderBook::match(LimitOrder &order) {
             }
             order.status = OrderStatus::partial;
             fill(it->second, order);
+            markChanged(false, it->first);
             if (it->second.nItems() == 0) {
                 sellOrders.erase(it++);
             } else {
@@ -233,6 +328,7 @@ void OrderBook::match(LimitOrder &order) {
             }
             order.status = OrderStatus::partial;
             fill(it->second, order);
+            markChanged(true, it->first);
             if (it->second.nItems() == 0) {
                 // Idiomatic way to erase items and while keeping a valid reverse iterator
                 it = decltype(it){buyOrders.erase(next(it).base())};
@@ -247,6 +343,11 @@ void OrderBook::match(LimitOrder &order) {
     }
 }
 
+long long OrderBook::nFills() {
+    std::shared_lock lock(ordersMutex);
+    return fills;
+}
+
 int OrderBook::pos(LimitOrder &order) {
     map<double, PriceLevel> *m = order.isBuyOrder ? &buyOrders : &sellOrders;
     shared_mutex *mutex = order.isBuyOrder ? &buyMutex : &sellMutex;
@@ -309,18 +410,18 @@ string OrderBook::queryOrder(long long orderID) {
         left = it->second.left;
         orderType = it->second.isBuyOrder ? "buy" : "sell";
         switch (it->second.status) {
-            case open:
+            case OrderStatus::open:
                 orderStatus = "open";
                 pos = this->pos(it->second);
                 break;
-            case partial:
+            case OrderStatus::partial:
                 orderStatus = "partial";
                 pos = this->pos(it->second);
                 break;
-            case executed:
+            case OrderStatus::executed:
                 orderStatus = "executed";
                 break;
-            case cancelled:
+            case OrderStatus::cancelled:
                 orderStatus = "cancelled";
                 break;
         }
@@ -330,3 +431,14 @@ string OrderBook::queryOrder(long long orderID) {
     oss << orderType << ", " << price << ", " << quantity << ", " << left << ", " << pos << ", " << orderStatus;
     return oss.str();
 }
+
+// Start or stop recording changed levels for flushChanges, stopping discards
+// the changes not flushed yet
+void OrderBook::trackChanges(bool enabled) {
+    std::lock_guard lock(changesMutex);
+    tracking.store(enabled, memory_order_relaxed);
+    if (!enabled) {
+        changedBids.clear();
+        changedAsks.clear();
+    }
+}
@@ -1,20 +1,32 @@
 #ifndef ORDERBOOK_H
 #define ORDERBOOK_H
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <map>
+#include <mutex>
 #include <set>
 #include <shared_mutex>
+#include <vector>
 
 using namespace std;
 
-enum OrderStatus {
+enum class OrderStatus {
     open,
     partial,
     executed,
     cancelled
 };
 
+// Aggregated state of a price level after a batch of commands
+struct LevelDelta {
+    bool bid;
+    double price;
+    long long quantity;
+    int nItems;
+};
+
 class LimitOrder {
    private:
     long long id;
@@ -56,19 +68,35 @@ class OrderBook {
     mutable shared_mutex sellMutex;
     mutable shared_mutex ordersMutex;
 
+    // Price levels modified since the last call to flushChanges, only recorded
+    // while tracking is enabled
+    atomic<bool> tracking;
+    set<double> changedBids;
+    set<double> changedAsks;
+    mutable mutex changesMutex;
+
     double tickSize;
     double precision;
 
+    // Number of resting orders hit by incoming orders, guarded by ordersMutex
+    long long fills;
+
+    void markChanged(bool bid, double price);
+
    public:
     OrderBook(double tickSize, double tolerance);
     bool add(LimitOrder &&order);
     bool amend(long long orderID, long quantity);
     bool cancel(long long orderID);
+    uint64_t digest();
     void fill(PriceLevel &pl, LimitOrder &order);
+    vector<LevelDelta> flushChanges();
     void match(LimitOrder &order);
+    long long nFills();
     int pos(LimitOrder &order);
     string queryDepth(bool bid, int depth);
     string queryOrder(long long orderID);
+    void trackChanges(bool enabled);
 };
 
 #endif /* ORDERBOOK_H */
@@ -0,0 +1,253 @@
+#include "replay.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include "order_book.hpp"
+
+// Read-only memory mapping of a whole file, lines are parsed in place
+class MappedFile {
+   private:
+    const char *data;
+    size_t size;
+
+   public:
+    MappedFile(const string &path) : data(nullptr), size(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw system_error(errno, generic_category(), "open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            int err = errno;
+            close(fd);
+            throw system_error(err, generic_category(), "fstat " + path);
+        }
+        size = st.st_size;
+        if (0 < size) {
+            void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                int err = errno;
+                close(fd);
+                throw system_error(err, generic_category(), "mmap " + path);
+            }
+            data = static_cast<const char *>(p);
+            madvise(p, size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+    ~MappedFile() {
+        if (data != nullptr) {
+            munmap(const_cast<char *>(data), size);
+        }
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    string_view view() const { return string_view(data, size); }
+};
+
+// Split a line on blanks, returns the number of tokens written
+static size_t tokenize(string_view line, string_view *tokens, size_t maxTokens) {
+    size_t n = 0;
+    size_t i = 0;
+    while (i < line.size()) {
+        i = line.find_first_not_of(" \t\r", i);
+        if (i == string_view::npos) {
+            break;
+        }
+        size_t j = line.find_first_of(" \t\r", i);
+        if (j == string_view::npos) {
+            j = line.size();
+        }
+        if (n == maxTokens) {
+            // Too many tokens, no command accepts this line
+            return maxTokens + 1;
+        }
+        tokens[n++] = line.substr(i, j - i);
+        i = j;
+    }
+    return n;
+}
+
+// Copy a token into a NUL terminated buffer for the strto* functions
+static bool copyToken(string_view token, char (&buf)[32]) {
+    if (token.empty() || sizeof(buf) <= token.size()) {
+        return false;
+    }
+    memcpy(buf, token.data(), token.size());
+    buf[token.size()] = '\0';
+    errno = 0;
+    return true;
+}
+
+// Same number syntax as stoll/stol/stod in the interactive program, except
+// that the whole token must be a number rather than only its prefix
+static bool parse(string_view token, long long &value) {
+    char buf[32];
+    char *end;
+    if (!copyToken(token, buf)) {
+        return false;
+    }
+    value = strtoll(buf, &end, 10);
+    return errno == 0 && end == buf + token.size();
+}
+
+static bool parse(string_view token, long &value) {
+    char buf[32];
+    char *end;
+    if (!copyToken(token, buf)) {
+        return false;
+    }
+    value = strtol(buf, &end, 10);
+    return errno == 0 && end == buf + token.size();
+}
+
+static bool parse(string_view token, double &value) {
+    char buf[32];
+    char *end;
+    if (!copyToken(token, buf)) {
+        return false;
+    }
+    value = strtod(buf, &end);
+    return errno == 0 && end == buf + token.size();
+}
+
+// Apply one command line to the order book, with the commands and arguments
+// of the interactive program, numbers being parsed more strictly (see parse).
+// Returns false if the command is invalid or rejected.
+static bool replayCommand(OrderBook &ob, string_view *tokens, size_t n) {
+    if (tokens[0] == "order") {
+        long long orderID;
+        long quantity;
+        double price;
+        if (n != 5 || (tokens[2] != "buy" && tokens[2] != "sell") || !parse(tokens[1], orderID) ||
+            !parse(tokens[3], quantity) || !parse(tokens[4], price)) {
+            return false;
+        }
+        return ob.add(LimitOrder(orderID, tokens[2] == "buy", quantity, price));
+    }
+    if (tokens[0] == "cancel") {
+        long long orderID;
+        return n == 2 && parse(tokens[1], orderID) && ob.cancel(orderID);
+    }
+    if (tokens[0] == "amend") {
+        long long orderID;
+        long quantity;
+        return n == 3 && parse(tokens[1], orderID) && parse(tokens[2], quantity) && ob.amend(orderID, quantity);
+    }
+    if (tokens[0] == "q") {
+        // Queries do not modify the book, only their syntax is checked
+        long long value;
+        if (2 < n && tokens[1] == "level") {
+            return n == 4 && (tokens[2] == "bid" || tokens[2] == "ask") && parse(tokens[3], value);
+        }
+        return n == 3 && tokens[1] == "order" && parse(tokens[2], value);
+    }
+    return false;
+}
+
+ReplaySummary replayFile(const string &path, double tickSize, double precision) {
+    ReplaySummary summary = {path, "", 0, 0, 0, 0, 0};
+    auto start = chrono::steady_clock::now();
+
+    OrderBook ob(tickSize, precision);
+    MappedFile file(path);
+    string_view data = file.view();
+    string_view tokens[5];
+    while (!data.empty()) {
+        size_t eol = data.find('\n');
+        string_view line = data.substr(0, eol);
+        data.remove_prefix(eol == string_view::npos ? data.size() : eol + 1);
+
+        size_t n = tokenize(line, tokens, 5);
+        if (n == 0) {
+            continue;
+        }
+        summary.commands++;
+        if (5 < n || !replayCommand(ob, tokens, n)) {
+            summary.rejected++;
+        }
+    }
+
+    summary.fills = ob.nFills();
+    summary.digest = ob.digest();
+    summary.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return summary;
+}
+
+// Replay every regular file of a directory, each into its own order book.
+// Files are handed out largest first to threads pulling from a shared index,
+// so that a long day does not start last and hold up the whole run.
+vector<ReplaySummary> replayDirectory(const string &directory, double tickSize, double precision, unsigned nThreads) {
+    vector<pair<uintmax_t, string>> files;
+    for (auto &entry : boost::filesystem::directory_iterator(directory)) {
+        if (boost::filesystem::is_regular_file(entry.status())) {
+            files.push_back({boost::filesystem::file_size(entry.path()), entry.path().string()});
+        }
+    }
+    sort(files.begin(), files.end(), [](auto &a, auto &b) { return b.first < a.first; });
+
+    // A file failing is reported in its summary, the other files still run
+    vector<ReplaySummary> summaries(files.size());
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            try {
+                summaries[i] = replayFile(files[i].second, tickSize, precision);
+            } catch (const exception &e) {
+                summaries[i] = {files[i].second, e.what(), 0, 0, 0, 0, 0};
+            }
+        }
+    };
+
+    nThreads = max(1u, min<unsigned>(nThreads, files.size()));
+    vector<thread> threads;
+    for (unsigned i = 1; i < nThreads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (thread &t : threads) {
+        t.join();
+    }
+    sort(summaries.begin(), summaries.end(), [](auto &a, auto &b) { return a.path < b.path; });
+    return summaries;
+}
+
+// One line per file, then the totals and the wall clock throughput. Files
+// that failed get a line with their error and are left out of the totals.
+string replayReport(const vector<ReplaySummary> &summaries, double seconds) {
+    long long commands = 0;
+    long long rejected = 0;
+    long long fills = 0;
+
+    ostringstream oss;
+    oss << "file, commands, rejected, fills, digest, seconds, commands/s" << endl;
+    for (const ReplaySummary &s : summaries) {
+        if (!s.error.empty()) {
+            oss << s.path << ", error: " << s.error << endl;
+            continue;
+        }
+        oss << s.path << ", " << s.commands << ", " << s.rejected << ", " << s.fills << ", " << hex << setw(16)
+            << setfill('0') << s.digest << dec << setfill(' ') << ", " << s.seconds << ", " << (0 < s.seconds ? s.commands / s.seconds : 0) << endl;
+        commands += s.commands;
+        rejected += s.rejected;
+        fills += s.fills;
+    }
+    oss << "total, " << commands << ", " << rejected << ", " << fills << ", -, " << seconds << ", "
+        << (0 < seconds ? commands / seconds : 0);
+    return oss.str();
+}
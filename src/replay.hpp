@@ -0,0 +1,26 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Outcome of replaying one command file into a fresh order book. If the file
+// could not be replayed, error holds the reason and the counters are zero.
+struct ReplaySummary {
+    string path;
+    string error;
+    long long commands;
+    long long rejected;
+    long long fills;
+    uint64_t digest;
+    double seconds;
+};
+
+ReplaySummary replayFile(const string &path, double tickSize, double precision);
+vector<ReplaySummary> replayDirectory(const string &directory, double tickSize, double precision, unsigned nThreads);
+string replayReport(const vector<ReplaySummary> &summaries, double seconds);
+
+#endif /* REPLAY_H */
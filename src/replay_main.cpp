@@ -0,0 +1,40 @@
+// Replays every command file of a directory, each into its own order book
+#include <stdio.h>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <thread>
+
+#include "replay.hpp"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    if (argc != 4 && argc != 5) {
+        fprintf(stdout, "Usage: %s tick_size precision directory [threads]\n", argv[0]);
+        return 1;
+    }
+
+    try {
+        double tickSize = stod(argv[1]);
+        double precision = stod(argv[2]);
+        unsigned nThreads = argc == 5 ? stoul(argv[4]) : thread::hardware_concurrency();
+
+        auto start = chrono::steady_clock::now();
+        vector<ReplaySummary> summaries = replayDirectory(argv[3], tickSize, precision, nThreads);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << replayReport(summaries, seconds) << endl;
+
+        // The report is complete, but some files could not be replayed
+        for (const ReplaySummary &s : summaries) {
+            if (!s.error.empty()) {
+                return 2;
+            }
+        }
+    } catch (const exception &e) {
+        cerr << "Replay failed: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
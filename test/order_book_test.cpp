@@ -1,8 +1,15 @@
 #define BOOST_TEST_MODULE OrderBookTests
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
+#include <fstream>
 #include <iostream>
 
+#include "market_data.hpp"
 #include "order_book.hpp"
+#include "replay.hpp"
 
 using namespace std;
 
@@ -143,4 +150,204 @@ BOOST_AUTO_TEST_CASE(MatchReverse) {
     BOOST_CHECK(ob.queryDepth(true, 1) == "bid, 1, 15.5, 50, 1");
 }
 
+BOOST_AUTO_TEST_CASE(FlushChanges) {
+    OrderBook ob = OrderBook(0.05, 0.001);
+    LimitOrder lo = LimitOrder(1000, true, 100, 11.5);
+    BOOST_CHECK(ob.add(move(lo)));
+    // Changes are only recorded once tracking is enabled
+    BOOST_CHECK(ob.flushChanges().empty());
+    ob.trackChanges(true);
+    lo = LimitOrder(1001, true, 100, 13.5);
+    BOOST_CHECK(ob.add(move(lo)));
+    lo = LimitOrder(1002, true, 100, 12.5);
+    BOOST_CHECK(ob.add(move(lo)));
+    lo = LimitOrder(1003, true, 100, 12.5);
+    BOOST_CHECK(ob.add(move(lo)));
+    vector<LevelDelta> deltas = ob.flushChanges();
+    // One delta per level, however many times it changed
+    BOOST_CHECK(deltas.size() == 2);
+    BOOST_CHECK(deltas[0].bid && deltas[0].price == 12.5 && deltas[0].quantity == 200 && deltas[0].nItems == 2);
+    BOOST_CHECK(deltas[1].bid && deltas[1].price == 13.5 && deltas[1].quantity == 100 && deltas[1].nItems == 1);
+    BOOST_CHECK(ob.flushChanges().empty());
+    // Sweep both bid levels and rest the remainder on the ask side
+    lo = LimitOrder(1004, false, 350, 12.5);
+    BOOST_CHECK(ob.add(move(lo)));
+    deltas = ob.flushChanges();
+    BOOST_CHECK(deltas.size() == 3);
+    BOOST_CHECK(deltas[0].bid && deltas[0].price == 12.5 && deltas[0].quantity == 0 && deltas[0].nItems == 0);
+    BOOST_CHECK(deltas[1].bid && deltas[1].price == 13.5 && deltas[1].quantity == 0 && deltas[1].nItems == 0);
+    BOOST_CHECK(!deltas[2].bid && deltas[2].price == 12.5 && deltas[2].quantity == 50 && deltas[2].nItems == 1);
+    // Amend the partially filled resting order
+    BOOST_CHECK(ob.amend(1004, 330));
+    deltas = ob.flushChanges();
+    BOOST_CHECK(deltas.size() == 1);
+    BOOST_CHECK(!deltas[0].bid && deltas[0].price == 12.5 && deltas[0].quantity == 30 && deltas[0].nItems == 1);
+    lo = LimitOrder(1005, true, 10, 12.5);
+    BOOST_CHECK(ob.add(move(lo)));
+    deltas = ob.flushChanges();
+    BOOST_CHECK(deltas.size() == 1);
+    BOOST_CHECK(!deltas[0].bid && deltas[0].price == 12.5 && deltas[0].quantity == 20 && deltas[0].nItems == 1);
+    // Cancelling it removes the level
+    BOOST_CHECK(ob.cancel(1004));
+    deltas = ob.flushChanges();
+    BOOST_CHECK(deltas.size() == 1);
+    BOOST_CHECK(!deltas[0].bid && deltas[0].price == 12.5 && deltas[0].quantity == 0 && deltas[0].nItems == 0);
+    BOOST_CHECK(ob.queryDepth(false, 1) == "ask, 1, 0, 0, 0");
+    ob.trackChanges(false);
+    BOOST_CHECK(ob.cancel(1000));
+    BOOST_CHECK(ob.flushChanges().empty());
+}
+
+BOOST_AUTO_TEST_CASE(MarketDataFeed) {
+    OrderBook ob = OrderBook(0.05, 0.001);
+    {
+        MarketDataPublisher publisher(ob, "/order_book_test_feed", 2);
+        MarketDataSubscriber subscriber("/order_book_test_feed");
+        LevelDelta delta;
+        bool overrun;
+        bool last;
+        BOOST_CHECK(!subscriber.poll(delta, overrun, last));
+        LimitOrder lo = LimitOrder(1001, true, 100, 12.5);
+        BOOST_CHECK(ob.add(move(lo)));
+        BOOST_CHECK(publisher.publish() == 1);
+        BOOST_CHECK(subscriber.poll(delta, overrun, last));
+        BOOST_CHECK(!overrun && last);
+        BOOST_CHECK(delta.bid && delta.price == 12.5 && delta.quantity == 100 && delta.nItems == 1);
+        BOOST_CHECK(!subscriber.poll(delta, overrun, last));
+        // Overrun the ring, only the latest deltas remain readable
+        lo = LimitOrder(1002, false, 100, 13.5);
+        BOOST_CHECK(ob.add(move(lo)));
+        lo = LimitOrder(1003, false, 100, 14.5);
+        BOOST_CHECK(ob.add(move(lo)));
+        lo = LimitOrder(1004, false, 100, 15.5);
+        BOOST_CHECK(ob.add(move(lo)));
+        BOOST_CHECK(publisher.publish() == 3);
+        BOOST_CHECK(subscriber.poll(delta, overrun, last));
+        BOOST_CHECK(overrun && !last);
+        BOOST_CHECK(!delta.bid && delta.price == 14.5);
+        BOOST_CHECK(subscriber.poll(delta, overrun, last));
+        BOOST_CHECK(!overrun && last);
+        BOOST_CHECK(!delta.bid && delta.price == 15.5);
+        BOOST_CHECK(!subscriber.poll(delta, overrun, last));
+    }
+    // Tracking stops with the publisher
+    BOOST_CHECK(ob.cancel(1001));
+    BOOST_CHECK(ob.flushChanges().empty());
+}
+
+BOOST_AUTO_TEST_CASE(MarketDataBatch) {
+    OrderBook ob = OrderBook(0.05, 0.001);
+    MarketDataPublisher publisher(ob, "/order_book_test_batch", 8);
+    MarketDataSubscriber subscriber("/order_book_test_batch");
+    LevelDelta delta;
+    bool overrun;
+    bool last;
+    LimitOrder lo = LimitOrder(1001, false, 100, 12.5);
+    BOOST_CHECK(ob.add(move(lo)));
+    BOOST_CHECK(publisher.publish() == 1);
+    BOOST_CHECK(subscriber.poll(delta, overrun, last));
+    BOOST_CHECK(last);
+    // Sweep the ask and rest the remainder as a bid, both deltas form one batch
+    lo = LimitOrder(1002, true, 150, 13.0);
+    BOOST_CHECK(ob.add(move(lo)));
+    BOOST_CHECK(publisher.publish() == 2);
+    BOOST_CHECK(subscriber.poll(delta, overrun, last));
+    BOOST_CHECK(!last);
+    BOOST_CHECK(delta.bid && delta.price == 13.0 && delta.quantity == 50 && delta.nItems == 1);
+    BOOST_CHECK(subscriber.poll(delta, overrun, last));
+    BOOST_CHECK(last);
+    BOOST_CHECK(!delta.bid && delta.price == 12.5 && delta.quantity == 0 && delta.nItems == 0);
+    BOOST_CHECK(!subscriber.poll(delta, overrun, last));
+}
+
+BOOST_AUTO_TEST_CASE(MarketDataStaleSegment) {
+    // Leave a segment filled with garbage, as a crashed publisher could
+    int fd = shm_open("/order_book_test_stale", O_CREAT | O_RDWR, 0644);
+    BOOST_REQUIRE(0 <= fd);
+    vector<char> garbage(4096, '\xff');
+    BOOST_CHECK(::write(fd, garbage.data(), garbage.size()) == (ssize_t)garbage.size());
+    close(fd);
+    // Not a ring, subscribers refuse it
+    BOOST_CHECK_THROW(MarketDataSubscriber("/order_book_test_stale"), runtime_error);
+
+    OrderBook ob = OrderBook(0.05, 0.001);
+    MarketDataPublisher publisher(ob, "/order_book_test_stale", 4);
+    MarketDataSubscriber subscriber("/order_book_test_stale");
+    LevelDelta delta;
+    bool overrun;
+    bool last;
+    BOOST_CHECK(!subscriber.poll(delta, overrun, last));
+    LimitOrder lo = LimitOrder(1001, false, 100, 12.5);
+    BOOST_CHECK(ob.add(move(lo)));
+    BOOST_CHECK(publisher.publish() == 1);
+    BOOST_CHECK(subscriber.poll(delta, overrun, last));
+    BOOST_CHECK(!overrun && last);
+    BOOST_CHECK(!delta.bid && delta.price == 12.5 && delta.quantity == 100 && delta.nItems == 1);
+
+    // Truncated below its capacity, subscribers refuse it
+    fd = shm_open("/order_book_test_stale", O_RDWR, 0);
+    BOOST_REQUIRE(0 <= fd);
+    BOOST_CHECK(ftruncate(fd, sizeof(DeltaRingHeader) + sizeof(DeltaRecord)) == 0);
+    close(fd);
+    BOOST_CHECK_THROW(MarketDataSubscriber("/order_book_test_stale"), runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(Replay) {
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() / "order_book_test_replay";
+    boost::filesystem::remove_all(dir);
+    boost::filesystem::create_directory(dir);
+    ofstream((dir / "day1.txt").string()) << "order 1001 buy 100 12.5\n"
+                                  "order 1002 buy 100 13.5\n"
+                                  "\n"
+                                  "q level bid 1\n"
+                                  "q level 1\n"
+                                  "order 1003 sell 150 12.5\n"
+                                  "order 1004 sell 100 13.01\n"
+                                  "order 1005 sell 100 12.5x\n"
+                                  "cancel 1001\n"
+                                  "unknown 1\n";
+    ofstream((dir / "day2.txt").string()) << "order 1001 sell +100 12.5\r\n"
+                                  "amend 1001 50";
+
+    vector<ReplaySummary> summaries = replayDirectory(dir.string(), 0.05, 0.001, 2);
+    BOOST_CHECK(summaries.size() == 2);
+    BOOST_CHECK(summaries[0].commands == 9);
+    BOOST_CHECK(summaries[0].rejected == 4);
+    BOOST_CHECK(summaries[0].fills == 2);
+    BOOST_CHECK(summaries[1].commands == 2);
+    BOOST_CHECK(summaries[1].rejected == 0);
+    BOOST_CHECK(summaries[1].fills == 0);
+
+    // Books with the same resting orders share a digest
+    OrderBook ob = OrderBook(0.05, 0.001);
+    LimitOrder lo = LimitOrder(1001, false, 50, 12.5);
+    BOOST_CHECK(ob.add(move(lo)));
+    BOOST_CHECK(summaries[1].digest == ob.digest());
+    BOOST_CHECK(summaries[0].digest == OrderBook(0.05, 0.001).digest());
+    boost::filesystem::remove_all(dir);
+    BOOST_CHECK_THROW(replayDirectory(dir.string(), 0.05, 0.001, 2), boost::filesystem::filesystem_error);
+}
+
+BOOST_AUTO_TEST_CASE(ReplayReport) {
+    vector<ReplaySummary> summaries = {{"day1.txt", "open day1.txt: Permission denied", 0, 0, 0, 0, 0},
+                                       {"day2.txt", "", 10, 1, 4, 0xabc, 2}};
+    BOOST_CHECK(replayReport(summaries, 4) ==
+                "file, commands, rejected, fills, digest, seconds, commands/s\n"
+                "day1.txt, error: open day1.txt: Permission denied\n"
+                "day2.txt, 10, 1, 4, 0000000000000abc, 2, 5\n"
+                "total, 10, 1, 4, -, 4, 2.5");
+}
+
+BOOST_AUTO_TEST_CASE(Digest) {
+    OrderBook bids = OrderBook(0.05, 0.001);
+    OrderBook asks = OrderBook(0.05, 0.001);
+    LimitOrder lo = LimitOrder(1, true, 10, 12.5);
+    BOOST_CHECK(bids.add(move(lo)));
+    lo = LimitOrder(1, false, 10, 12.5);
+    BOOST_CHECK(asks.add(move(lo)));
+    // Same fields on opposite sides are different books
+    BOOST_CHECK(bids.digest() != asks.digest());
+    BOOST_CHECK(bids.digest() != OrderBook(0.05, 0.001).digest());
+}
+
 BOOST_AUTO_TEST_SUITE_END()